@@ -6,16 +6,33 @@ using namespace std;
 
 // CPU constructor
 CPU::CPU() {
-    // Initialize registers and memory to 0
-    for (int i = 0; i < 12; ++i) {
-        regs[i] = 0;
+    // Initialize registers, memory and flags to 0
+    reset();
+}
+
+// Use external words as memory
+void CPU::attachMemory(uint32_t *words, uint32_t count) {
+    memStorage.clear();
+    mem = words;
+    memWords = count;
+}
+
+// Load data words into memory from MEM_BASE
+bool CPU::loadData(const vector<uint32_t> &data) {
+    if (data.size() > memWords) {
+        // memStorage is empty when the memory is attached and cannot grow
+        if (!memStorage.empty()) {
+            memStorage.resize(data.size(), 0);
+            mem = memStorage.data();
+            memWords = static_cast<uint32_t>(data.size());
+        } else {
+            return false;
+        }
     }
-    for (int i = 0; i < 5; ++i) {
-        mem[i] = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        mem[i] = data[i];
     }
-
-    // Initialize flags
-    nzcv = Flags{};
+    return true;
 }
 
 // Check if address is in memory range
@@ -28,8 +45,11 @@ bool CPU::inMemRange(uint32_t addr, int &index) const {
     if (offset % 4 != 0) {
         return false;
     }
+    if (offset / 4 >= memWords) {
+        return false;
+    }
     index = static_cast<int>(offset / 4);
-    return (index >= 0 && index < 5);
+    return true;
 }
 
 // Get the value of operand 2
@@ -133,15 +153,34 @@ void CPU::printState(const Instruction &ins) const {
          << (nzcv.Z ? '1' : '0')
          << (nzcv.C ? '1' : '0')
          << (nzcv.V ? '1' : '0') << "\n";
-    // Print memory
+    // Print memory (only the first MEM_WORDS words)
     cout << "Memory array:\n";
-    for (int i = 0; i < 5; i++) {
+    uint32_t shown = (memWords < MEM_WORDS) ? memWords : MEM_WORDS;
+    for (uint32_t i = 0; i < shown; i++) {
         if (mem[i] == 0) cout << "___";
         else cout << toHex(mem[i]);
-        if (i < 4) cout << ",";
+        if (i + 1 < shown) cout << ",";
     }
     cout << "\n";
 }
+// Tell the observer about an instruction, or print the state
+void CPU::report(const Instruction &ins, bool executed) const {
+    if (observer) observer(ins, *this, executed);
+    else if (trace) printState(ins);
+}
+
+// Put registers, flags and memory back to the starting state
+void CPU::reset() {
+    for (int i = 0; i < 12; ++i) {
+        regs[i] = 0;
+    }
+    // our own memory again, even if an image was attached
+    memStorage.assign(MEM_WORDS, 0);
+    mem = memStorage.data();
+    memWords = MEM_WORDS;
+    nzcv = Flags{};
+}
+
 // Decode an opcode into base, condition, and setsS
 void decodeOpcode(const string &opcode_in, string &base, string &cond, bool &setsS) {
     string opcode = opcode_in;
@@ -149,6 +188,11 @@ void decodeOpcode(const string &opcode_in, string &base, string &cond, bool &set
     cond.clear();
     setsS = false;
     if (opcode.empty()) return;
+    // BEQ is its own opcode, the EQ is not a condition suffix on B
+    if (opcode == "BEQ") {
+        base = opcode;
+        return;
+    }
     if (opcode.back() == 'S') {
         setsS = true;
         opcode.pop_back();
@@ -191,155 +235,164 @@ void CPU::run(const vector<Instruction> &program) {
     int programSize = static_cast<int>(program.size());
 
     while (programCounter < programSize) {
-        const Instruction &ins = program[programCounter];
-        // Handle label-only instruction
-        if (ins.op == OpType::INVALID && ins.hasLabel) {
+        programCounter = step(program, programCounter);
+    }
+}
+
+// Execute the single instruction at programCounter and return the next one
+int CPU::step(const vector<Instruction> &program, int programCounter) {
+    const Instruction &ins = program[programCounter];
+    // Handle label-only instruction
+    if (ins.op == OpType::INVALID && ins.hasLabel) {
+        if (observer) {
+            observer(ins, *this, false);
+        } else if (trace) {
             Instruction tmp = ins;
             tmp.raw = ins.label + ":";
             printState(tmp);
-            programCounter++;
-            continue;
         }
+        return programCounter + 1;
+    }
 
-        // Evaluate condition
-        bool shouldExecute = condHolds(ins.cond);
-        if (!shouldExecute) {
-            printState(ins);
-            programCounter++;
-            continue;
-        }
+    // Evaluate condition
+    bool shouldExecute = condHolds(ins.cond);
+    if (!shouldExecute) {
+        report(ins, false);
+        return programCounter + 1;
+    }
 
-        // Execute instruction
-        switch (ins.op) {
-            case OpType::ADD: {
-                // Get the first operand from register Rn if valid, else 0
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                // Get the second operand
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = static_cast<uint32_t>(
-                    (static_cast<uint64_t>(firstOperand) + static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
-                 // Store the result in Rd if valid
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                // Update condition flags
-                if (ins.setsFlags) updateFlagsAdd(firstOperand, secondOperand, result);
-                break;
-            }
-            case OpType::SUB: {
-                // Get the first operand from register Rn if valid, else 0
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                // Get the second operand
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = static_cast<uint32_t>(
-                    (static_cast<uint64_t>(firstOperand) - static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
-                // Store the result in Rd if valid
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                // Update condition flags
-                if (ins.setsFlags) updateFlagsSub(firstOperand, secondOperand, result);
-                break;
-            }
-            case OpType::AND: {
-                // Bitwise AND between operands
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = firstOperand & secondOperand;
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                if (ins.setsFlags) updateFlagsLogical(result);
-                break;
-            }
-            case OpType::ORR: {
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = firstOperand | secondOperand;
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                if (ins.setsFlags) updateFlagsLogical(result);
-                break;
-            }
-            case OpType::EOR: {
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = firstOperand ^ secondOperand;
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                if (ins.setsFlags) updateFlagsLogical(result);
-                break;
-            }
-            case OpType::LSL: {
-                uint32_t value = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t shiftAmount = getOp2Value(ins) & 0x1F;
-                uint32_t result = (shiftAmount >= 32) ? 0 : (value << shiftAmount);
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                if (ins.setsFlags) {
-                    if (shiftAmount != 0) nzcv.C = ((value >> (32 - shiftAmount)) & 1);
-                    updateFlagsLogical(result);
-                }
-                break;
-            }
-            case OpType::LSR: {
-                uint32_t value = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t shiftAmount = getOp2Value(ins) & 0x1F;
-                uint32_t result = (shiftAmount >= 32) ? 0 : (value >> shiftAmount);
-                if (ins.Rd >= 0) regs[ins.Rd] = result;
-                if (ins.setsFlags) {
-                    if (shiftAmount != 0) nzcv.C = ((value >> (shiftAmount - 1)) & 1);
-                    updateFlagsLogical(result);
-                }
-                break;
-            }
-            case OpType::MOV: {
-                uint32_t value = getOp2Value(ins);
-                if (ins.Rd >= 0) regs[ins.Rd] = value;
-                if (ins.setsFlags) updateFlagsLogical(value);
-                break;
+    // Execute instruction
+    switch (ins.op) {
+        case OpType::ADD: {
+            // Get the first operand from register Rn if valid, else 0
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            // Get the second operand
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = static_cast<uint32_t>(
+                (static_cast<uint64_t>(firstOperand) + static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
+             // Store the result in Rd if valid
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            // Update condition flags
+            if (ins.setsFlags) updateFlagsAdd(firstOperand, secondOperand, result);
+            break;
+        }
+        case OpType::SUB: {
+            // Get the first operand from register Rn if valid, else 0
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            // Get the second operand
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = static_cast<uint32_t>(
+                (static_cast<uint64_t>(firstOperand) - static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
+            // Store the result in Rd if valid
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            // Update condition flags
+            if (ins.setsFlags) updateFlagsSub(firstOperand, secondOperand, result);
+            break;
+        }
+        case OpType::AND: {
+            // Bitwise AND between operands
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = firstOperand & secondOperand;
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            if (ins.setsFlags) updateFlagsLogical(result);
+            break;
+        }
+        case OpType::ORR: {
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = firstOperand | secondOperand;
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            if (ins.setsFlags) updateFlagsLogical(result);
+            break;
+        }
+        case OpType::EOR: {
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = firstOperand ^ secondOperand;
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            if (ins.setsFlags) updateFlagsLogical(result);
+            break;
+        }
+        case OpType::LSL: {
+            uint32_t value = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t shiftAmount = getOp2Value(ins) & 0x1F;
+            uint32_t result = (shiftAmount >= 32) ? 0 : (value << shiftAmount);
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            if (ins.setsFlags) {
+                if (shiftAmount != 0) nzcv.C = ((value >> (32 - shiftAmount)) & 1);
+                updateFlagsLogical(result);
             }
-            case OpType::MVN: {
-                uint32_t value = ~getOp2Value(ins);
-                if (ins.Rd >= 0) regs[ins.Rd] = value;
-                if (ins.setsFlags) updateFlagsLogical(value);
-                break;
+            break;
+        }
+        case OpType::LSR: {
+            uint32_t value = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t shiftAmount = getOp2Value(ins) & 0x1F;
+            uint32_t result = (shiftAmount >= 32) ? 0 : (value >> shiftAmount);
+            if (ins.Rd >= 0) regs[ins.Rd] = result;
+            if (ins.setsFlags) {
+                if (shiftAmount != 0) nzcv.C = ((value >> (shiftAmount - 1)) & 1);
+                updateFlagsLogical(result);
             }
-            case OpType::LDR: {
-                uint32_t address = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                int memoryIndex = -1;
-                if (inMemRange(address, memoryIndex)) {
-                    if (ins.Rd >= 0) regs[ins.Rd] = mem[memoryIndex];
-                }
-                break;
+            break;
+        }
+        case OpType::MOV: {
+            uint32_t value = getOp2Value(ins);
+            if (ins.Rd >= 0) regs[ins.Rd] = value;
+            if (ins.setsFlags) updateFlagsLogical(value);
+            break;
+        }
+        case OpType::MVN: {
+            uint32_t value = ~getOp2Value(ins);
+            if (ins.Rd >= 0) regs[ins.Rd] = value;
+            if (ins.setsFlags) updateFlagsLogical(value);
+            break;
+        }
+        case OpType::LDR: {
+            uint32_t address = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            int memoryIndex = -1;
+            if (inMemRange(address, memoryIndex)) {
+                if (ins.Rd >= 0) regs[ins.Rd] = mem[memoryIndex];
             }
-            case OpType::STR: {
-                // Store word from Rd into memory
-                uint32_t address = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                int memoryIndex = -1;
-                if (inMemRange(address, memoryIndex)) {
-                    if (ins.Rd >= 0) mem[memoryIndex] = regs[ins.Rd];
+            break;
+        }
+        case OpType::STR: {
+            // Store word from Rd into memory
+            uint32_t address = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            int memoryIndex = -1;
+            if (inMemRange(address, memoryIndex)) {
+                if (ins.Rd >= 0) {
+                    if (storeLog) storeLog->push_back({static_cast<uint32_t>(memoryIndex), mem[memoryIndex]});
+                    mem[memoryIndex] = regs[ins.Rd];
                 }
-                break;
-            }
-            case OpType::CMP: {
-                  // Compare Rn with operand
-                uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
-                uint32_t secondOperand = getOp2Value(ins);
-                uint32_t result = static_cast<uint32_t>(
-                    (static_cast<uint64_t>(firstOperand) - static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
-                updateFlagsSub(firstOperand, secondOperand, result);
-                break;
             }
-            case OpType::BEQ: {
-                // Branch if equal (zero flag set)
-                bool isZeroFlagSet = nzcv.Z;
-                if (isZeroFlagSet == true) {
-                    if (ins.branchTarget >= 0) {
-                        programCounter = ins.branchTarget;
-                        printState(ins);
-                        continue;//skip the rest of the instructions in loop
-                    }
+            break;
+        }
+        case OpType::CMP: {
+              // Compare Rn with operand
+            uint32_t firstOperand = (ins.Rn >= 0 ? regs[ins.Rn] : 0);
+            uint32_t secondOperand = getOp2Value(ins);
+            uint32_t result = static_cast<uint32_t>(
+                (static_cast<uint64_t>(firstOperand) - static_cast<uint64_t>(secondOperand)) & 0xFFFFFFFFu);
+            updateFlagsSub(firstOperand, secondOperand, result);
+            break;
+        }
+        case OpType::BEQ: {
+            // Branch if equal (zero flag set)
+            bool isZeroFlagSet = nzcv.Z;
+            if (isZeroFlagSet == true) {
+                if (ins.branchTarget >= 0) {
+                    report(ins, true);
+                    return ins.branchTarget;//skip the rest of the instruction
                 }
-                break;
             }
-            default:
-                //this shoulddd take care of unsupported or unimplemented instructions
-                break;
+            break;
         }
-
-        printState(ins);
-        programCounter++;
+        default:
+            //this shoulddd take care of unsupported or unimplemented instructions
+            break;
     }
+
+    report(ins, true);
+    return programCounter + 1;
 }
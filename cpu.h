@@ -3,12 +3,16 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <cstdint>
+#include <functional>
 #include "instr.h"
 using namespace std;
 
 // The CPU memory starts at this address in our simulation
 const uint32_t MEM_BASE = 0x100; //start of CPU memory
+const uint32_t MEM_WORDS = 5;    //default size of CPU memory in words
+const uint64_t MEM_MAX_BYTES = 0xF0000000u; //most memory that fits above MEM_BASE
 
 struct Flags {
     bool N = false;
@@ -17,9 +21,17 @@ struct Flags {
     bool V = false;
 };
 
+class CPU;
+
+// called after every instruction step instead of printing the state;
+// executed is false for label-only lines and instructions whose condition failed
+typedef function<void(const Instruction &ins, const CPU &cpu, bool executed)> StepObserver;
+
 class CPU {
 public:
     CPU();
+    CPU(const CPU &) = delete;            //mem may point into memStorage
+    CPU &operator=(const CPU &) = delete;
 
     // Check if an address is in memory range
     bool inMemRange(uint32_t addr, int &index) const;
@@ -38,12 +50,33 @@ public:
     //print CPU state for debugging
     void printState(const Instruction &ins) const;
 
+    //pass an instruction to the observer, or print the state if tracing
+    void report(const Instruction &ins, bool executed) const;
+
+    //zero registers and flags, go back to the default memory
+    void reset();
+
     //run the instrutions
     void run(const vector<Instruction> &program);
 
+    //execute one instruction and return the index of the next one
+    int step(const vector<Instruction> &program, int programCounter);
+
+    //use words outside the CPU (like a mapped file) as memory
+    void attachMemory(uint32_t *words, uint32_t count);
+
+    //write data words starting at MEM_BASE, growing our own memory if needed
+    //returns false if attached memory is too small
+    bool loadData(const vector<uint32_t> &data);
+
     uint32_t regs[12];
-    uint32_t mem[5];
+    uint32_t *mem;                //memory starting at MEM_BASE
+    uint32_t memWords;            //number of words in mem
+    vector<uint32_t> memStorage;  //backs mem unless memory is attached
     Flags nzcv;
+    bool trace = true;     //print the state after every instruction
+    StepObserver observer; //if set, called instead of printing
+    vector<pair<uint32_t, uint32_t>> *storeLog = nullptr; //if set, STR adds (word index, old value)
 };
 
 //decode a string opcode into base, cond, and setsS flag
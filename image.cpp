@@ -0,0 +1,62 @@
+#include "image.h"
+#include "cpu.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+using namespace std;
+
+GuestImage::GuestImage() : base(nullptr), length(0), count(0) {}
+
+GuestImage::~GuestImage() {
+    if (base != nullptr) {
+        munmap(base, length);
+    }
+}
+
+// Map the file as CPU memory
+bool GuestImage::map(const string &path, bool persist, string &error) {
+    int fd = open(path.c_str(), persist ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        error = "Unable to open image: " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = "Unable to stat image: " + path + ": " + strerror(errno);
+        close(fd);
+        return false;
+    }
+    if (info.st_size == 0) {
+        error = "Image is empty: " + path;
+        close(fd);
+        return false;
+    }
+    // memory addresses are 32 bits, so the image has to fit above MEM_BASE
+    if (static_cast<uint64_t>(info.st_size) > MEM_MAX_BYTES) {
+        error = "Image is too large: " + path;
+        close(fd);
+        return false;
+    }
+
+    // the rest of the last page reads as zero, so a partial last word is fine
+    size_t size = static_cast<size_t>(info.st_size);
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         persist ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = "Unable to map image: " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    if (base != nullptr) {
+        munmap(base, length);
+    }
+    base = mapping;
+    length = size;
+    count = static_cast<uint32_t>((size + 3) / 4);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// A binary file mapped into memory so it can be used as CPU memory.
+// Pages are only read in when the program touches them.
+class GuestImage {
+public:
+    GuestImage();
+    ~GuestImage();
+    GuestImage(const GuestImage &) = delete;
+    GuestImage &operator=(const GuestImage &) = delete;
+
+    // map a file, stores go back to the file if persist is true,
+    // otherwise they stay private (copy-on-write)
+    bool map(const string &path, bool persist, string &error);
+
+    uint32_t *words() const { return static_cast<uint32_t *>(base); }
+    uint32_t wordCount() const { return count; }
+
+private:
+    void *base;      // start of the mapping
+    size_t length;   // length of the mapping in bytes
+    uint32_t count;  // number of words, a partial last word counts as one
+};
+
+#endif
@@ -40,6 +40,7 @@ struct Instruction {
     bool setsFlags = false;      //does update the flags orr
     string label;           // abel for branching
     bool hasLabel = false;       //True if instruction has a label
+    string targetLabel;     //label a BEQ branches to
     string args;            //ops as raw text
     int Rn = -1;                 //first register operand
     int Rd = -1;                 //destination register
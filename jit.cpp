@@ -0,0 +1,512 @@
+#include "jit.h"
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+using namespace std;
+
+namespace {
+
+// x86-64 register numbers
+const int RAX = 0;
+const int RBX = 3;
+const int RBP = 5; // memory base pointer for LDR/STR
+const int RDI = 7; // holds the CPU pointer inside a block
+const int R12 = 12;
+const int R13 = 13;
+const int R14 = 14;
+const int R15 = 15;
+
+// host register for each guest register R0-R11 (rax is scratch, rdi is the CPU)
+const int hostReg[12] = {1, 2, 3, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+
+// size of each piece of executable memory blocks are packed into
+const size_t CHUNK_SIZE = 64 * 1024;
+
+// callee-saved registers we use and have to restore
+const int savedRegs[6] = {RBX, RBP, R12, R13, R14, R15};
+
+// x86 condition codes
+const int CC_O = 0x0;
+const int CC_B = 0x2;
+const int CC_AE = 0x3;
+const int CC_E = 0x4;
+const int CC_NE = 0x5;
+const int CC_S = 0x8;
+
+// where things live inside CPU, measured on a real object because
+// CPU is not standard-layout (offsetof is not guaranteed to work)
+struct Layout {
+    int32_t regs, mem, memWords, n, z, c, v;
+};
+
+Layout layoutOf(const CPU &cpu) {
+    const char *base = reinterpret_cast<const char *>(&cpu);
+    auto offset = [base](const void *field) {
+        return static_cast<int32_t>(static_cast<const char *>(field) - base);
+    };
+    Layout layout;
+    layout.regs = offset(&cpu.regs);
+    layout.mem = offset(&cpu.mem);
+    layout.memWords = offset(&cpu.memWords);
+    layout.n = offset(&cpu.nzcv.N);
+    layout.z = offset(&cpu.nzcv.Z);
+    layout.c = offset(&cpu.nzcv.C);
+    layout.v = offset(&cpu.nzcv.V);
+    return layout;
+}
+
+// A small x86-64 instruction encoder, all ALU work is 32-bit
+struct Emitter {
+    vector<uint8_t> code;
+
+    void emit(uint8_t b) { code.push_back(b); }
+    void emit32(uint32_t v) {
+        for (int i = 0; i < 4; i++) emit(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    // REX prefix, only emitted when an extended register is used
+    void rex(int reg, int base) {
+        uint8_t prefix = 0x40 | (((reg >> 3) & 1) << 2) | ((base >> 3) & 1);
+        if (prefix != 0x40) emit(prefix);
+    }
+    // op r/m32, r32 between two registers (mov 89, add 01, sub 29, ...)
+    void aluRR(uint8_t opcode, int dst, int src) {
+        rex(src, dst);
+        emit(opcode);
+        emit(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+    // op r/m32, imm32 (81 /ext)
+    void aluRI(int ext, int dst, uint32_t imm) {
+        rex(0, dst);
+        emit(0x81);
+        emit(0xC0 | (ext << 3) | (dst & 7));
+        emit32(imm);
+    }
+    void movRI(int dst, uint32_t imm) {
+        rex(0, dst);
+        emit(0xB8 + (dst & 7));
+        emit32(imm);
+    }
+    // mov r32, [rdi + disp] and mov [rdi + disp], r32
+    void loadState(int dst, int32_t disp) {
+        rex(dst, 0);
+        emit(0x8B);
+        emit(0x80 | ((dst & 7) << 3) | RDI);
+        emit32(disp);
+    }
+    void storeState(int src, int32_t disp) {
+        rex(src, 0);
+        emit(0x89);
+        emit(0x80 | ((src & 7) << 3) | RDI);
+        emit32(disp);
+    }
+    // mov r64, [rdi + disp]
+    void loadStatePtr(int dst, int32_t disp) {
+        emit(0x48 | ((dst >> 3) & 1) << 2);
+        emit(0x8B);
+        emit(0x80 | ((dst & 7) << 3) | RDI);
+        emit32(disp);
+    }
+    // cmp r32, [rdi + disp]
+    void cmpState(int r, int32_t disp) {
+        rex(r, 0);
+        emit(0x3B);
+        emit(0x80 | ((r & 7) << 3) | RDI);
+        emit32(disp);
+    }
+    // mov r32, [rbp + rax*4] and mov [rbp + rax*4], r32
+    void loadIndexed(int dst) {
+        rex(dst, 0);
+        emit(0x8B);
+        emit(0x44 | ((dst & 7) << 3));
+        emit(0x80 | (RAX << 3) | RBP);
+        emit(0);
+    }
+    void storeIndexed(int src) {
+        rex(src, 0);
+        emit(0x89);
+        emit(0x44 | ((src & 7) << 3));
+        emit(0x80 | (RAX << 3) | RBP);
+        emit(0);
+    }
+    // setcc byte [rdi + disp]
+    void setFlag(int cc, int32_t disp) {
+        emit(0x0F);
+        emit(0x90 + cc);
+        emit(0x80 | RDI);
+        emit32(disp);
+    }
+    // cmp byte [rdi + disp], 0
+    void testFlag(int32_t disp) {
+        emit(0x80);
+        emit(0x80 | (7 << 3) | RDI);
+        emit32(disp);
+        emit(0);
+    }
+    // mov al, [rdi + disp] then cmp al, [rdi + disp2]
+    void compareFlags(int32_t disp, int32_t disp2) {
+        emit(0x8A);
+        emit(0x80 | RDI);
+        emit32(disp);
+        emit(0x3A);
+        emit(0x80 | RDI);
+        emit32(disp2);
+    }
+    void testReg(int r) { aluRR(0x85, r, r); }
+    void notReg(int r) {
+        rex(0, r);
+        emit(0xF7);
+        emit(0xD0 | (r & 7));
+    }
+    // shl (ext 4) or shr (ext 5) r32, imm8
+    void shiftRI(int ext, int r, uint8_t amount) {
+        rex(0, r);
+        emit(0xC1);
+        emit(0xC0 | (ext << 3) | (r & 7));
+        emit(amount);
+    }
+    void push(int r) {
+        if (r >= 8) emit(0x41);
+        emit(0x50 + (r & 7));
+    }
+    void pop(int r) {
+        if (r >= 8) emit(0x41);
+        emit(0x58 + (r & 7));
+    }
+    // jcc rel32, returns where the offset goes so it can be patched later
+    size_t jcc(int cc) {
+        emit(0x0F);
+        emit(0x80 + cc);
+        size_t at = code.size();
+        emit32(0);
+        return at;
+    }
+    // point a jump at the current position
+    void patch(size_t at) {
+        uint32_t rel = static_cast<uint32_t>(code.size() - (at + 4));
+        for (int i = 0; i < 4; i++) code[at + i] = static_cast<uint8_t>(rel >> (8 * i));
+    }
+};
+
+bool validReg(int reg) {
+    return reg >= -1 && reg < 12;
+}
+
+// Check if an instruction can be translated
+bool jitSupports(const Instruction &ins) {
+    if (!validReg(ins.Rd) || !validReg(ins.Rn)) return false;
+    if (!ins.op2.isImmediate && !validReg(ins.op2.reg)) return false;
+    if (!ins.cond.empty() && ins.cond != "EQ" && ins.cond != "NE" && ins.cond != "GT" &&
+        ins.cond != "GE" && ins.cond != "LT" && ins.cond != "LE") {
+        return false;
+    }
+    // shifts by a register amount are left to the interpreter
+    if ((ins.op == OpType::LSL || ins.op == OpType::LSR) &&
+        !ins.op2.isImmediate && ins.op2.reg >= 0) {
+        return false;
+    }
+    return true;
+}
+
+bool writesRd(OpType op) {
+    switch (op) {
+        case OpType::ADD: case OpType::SUB: case OpType::AND: case OpType::ORR:
+        case OpType::EOR: case OpType::LSL: case OpType::LSR: case OpType::MOV:
+        case OpType::MVN: case OpType::LDR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Translates one block
+class BlockCompiler {
+public:
+    BlockCompiler(const Layout &layout, const vector<bool> &used, const vector<bool> &written)
+        : layout(layout), used(used), written(written) {}
+
+    void prologue() {
+        for (int r : savedRegs) e.push(r);
+        for (int i = 0; i < 12; i++) {
+            if (used[i]) e.loadState(hostReg[i], layout.regs + 4 * i);
+        }
+    }
+
+    // write back guest registers and return next to the caller
+    void exitTo(int next) {
+        for (int i = 0; i < 12; i++) {
+            if (written[i]) e.storeState(hostReg[i], layout.regs + 4 * i);
+        }
+        e.movRI(RAX, static_cast<uint32_t>(next));
+        for (int i = 5; i >= 0; i--) e.pop(savedRegs[i]);
+        e.emit(0xC3); // ret
+    }
+
+    // emit jumps that skip the instruction when its condition fails
+    void condSkip(const string &cond, vector<size_t> &skips) {
+        if (cond == "EQ") {
+            e.testFlag(layout.z);
+            skips.push_back(e.jcc(CC_E));
+        } else if (cond == "NE") {
+            e.testFlag(layout.z);
+            skips.push_back(e.jcc(CC_NE));
+        } else if (cond == "GE") {
+            e.compareFlags(layout.n, layout.v);
+            skips.push_back(e.jcc(CC_NE));
+        } else if (cond == "LT") {
+            e.compareFlags(layout.n, layout.v);
+            skips.push_back(e.jcc(CC_E));
+        } else if (cond == "GT") {
+            e.testFlag(layout.z);
+            skips.push_back(e.jcc(CC_NE));
+            e.compareFlags(layout.n, layout.v);
+            skips.push_back(e.jcc(CC_NE));
+        } else if (cond == "LE") {
+            e.testFlag(layout.z);
+            size_t run = e.jcc(CC_NE);
+            e.compareFlags(layout.n, layout.v);
+            skips.push_back(e.jcc(CC_E));
+            e.patch(run);
+        }
+    }
+
+    // eax = Rn, or 0 if there is no Rn
+    void loadRn(int reg) {
+        if (reg >= 0) e.aluRR(0x89, RAX, hostReg[reg]);
+        else e.movRI(RAX, 0);
+    }
+
+    // eax = eax op operand 2
+    void applyOp2(int ext, uint8_t opcode, const Op2 &op2) {
+        if (op2.isImmediate) e.aluRI(ext, RAX, op2.imm);
+        else if (op2.reg >= 0) e.aluRR(opcode, RAX, hostReg[op2.reg]);
+        else e.aluRI(ext, RAX, 0);
+    }
+
+    void storeRd(int reg) {
+        if (reg >= 0) e.aluRR(0x89, hostReg[reg], RAX);
+    }
+
+    void setNZ() {
+        e.setFlag(CC_S, layout.n);
+        e.setFlag(CC_E, layout.z);
+    }
+
+    // ADD/SUB/CMP: the host flags give all four guest flags
+    void arith(const Instruction &ins, int ext, uint8_t opcode, int carryCC, bool flags, bool store) {
+        loadRn(ins.Rn);
+        applyOp2(ext, opcode, ins.op2);
+        if (flags) {
+            e.setFlag(carryCC, layout.c);
+            e.setFlag(CC_O, layout.v);
+            setNZ();
+        }
+        if (store) storeRd(ins.Rd);
+    }
+
+    // AND/ORR/EOR: C and V are left alone
+    void logical(const Instruction &ins, int ext, uint8_t opcode) {
+        loadRn(ins.Rn);
+        applyOp2(ext, opcode, ins.op2);
+        if (ins.setsFlags) setNZ();
+        storeRd(ins.Rd);
+    }
+
+    void shift(const Instruction &ins, int ext) {
+        uint8_t amount = static_cast<uint8_t>((ins.op2.isImmediate ? ins.op2.imm : 0) & 0x1F);
+        loadRn(ins.Rn);
+        if (amount != 0) {
+            // the last bit shifted out lands in the host carry flag
+            e.shiftRI(ext, RAX, amount);
+            if (ins.setsFlags) e.setFlag(CC_B, layout.c);
+        } else if (ins.setsFlags) {
+            e.testReg(RAX);
+        }
+        if (ins.setsFlags) setNZ();
+        storeRd(ins.Rd);
+    }
+
+    void move(const Instruction &ins, bool invert) {
+        if (ins.op2.isImmediate) e.movRI(RAX, ins.op2.imm);
+        else loadRn(ins.op2.reg);
+        if (invert) e.notReg(RAX);
+        if (ins.setsFlags) {
+            e.testReg(RAX);
+            setNZ();
+        }
+        storeRd(ins.Rd);
+    }
+
+    // LDR/STR: the address must be word aligned and inside guest memory
+    void memory(const Instruction &ins, bool load) {
+        if (ins.Rd < 0) return;
+        loadRn(ins.Rn);
+        e.aluRI(5, RAX, MEM_BASE);   // sub eax, MEM_BASE
+        e.emit(0xA8);                // test al, 3
+        e.emit(3);
+        size_t unaligned = e.jcc(CC_NE);
+        e.shiftRI(5, RAX, 2);        // word index
+        e.cmpState(RAX, layout.memWords);
+        size_t outside = e.jcc(CC_AE);
+        e.loadStatePtr(RBP, layout.mem);
+        if (load) e.loadIndexed(hostReg[ins.Rd]);
+        else e.storeIndexed(hostReg[ins.Rd]);
+        e.patch(outside);
+        e.patch(unaligned);
+    }
+
+    // returns false if ins ends the block (it already emitted the exits)
+    bool instruction(const Instruction &ins, int index) {
+        if (ins.op == OpType::INVALID || ins.op == OpType::NOP) return true;
+
+        vector<size_t> skips;
+        condSkip(ins.cond, skips);
+
+        switch (ins.op) {
+            case OpType::ADD: arith(ins, 0, 0x01, CC_B, ins.setsFlags, true); break;
+            case OpType::SUB: arith(ins, 5, 0x29, CC_AE, ins.setsFlags, true); break;
+            case OpType::CMP: arith(ins, 7, 0x39, CC_AE, true, false); break;
+            case OpType::AND: logical(ins, 4, 0x21); break;
+            case OpType::ORR: logical(ins, 1, 0x09); break;
+            case OpType::EOR: logical(ins, 6, 0x31); break;
+            case OpType::LSL: shift(ins, 4); break;
+            case OpType::LSR: shift(ins, 5); break;
+            case OpType::MOV: move(ins, false); break;
+            case OpType::MVN: move(ins, true); break;
+            case OpType::LDR: memory(ins, true); break;
+            case OpType::STR: memory(ins, false); break;
+            case OpType::BEQ: {
+                if (ins.branchTarget < 0) break;
+                e.testFlag(layout.z);
+                skips.push_back(e.jcc(CC_E));
+                exitTo(ins.branchTarget);
+                for (size_t at : skips) e.patch(at);
+                exitTo(index + 1);
+                return false;
+            }
+            default:
+                break;
+        }
+        for (size_t at : skips) e.patch(at);
+        return true;
+    }
+
+    Emitter e;
+
+private:
+    Layout layout;
+    const vector<bool> &used;
+    const vector<bool> &written;
+};
+
+} // namespace
+
+Jit::Jit() {}
+
+Jit::~Jit() {
+#if JIT_SUPPORTED
+    for (CodeChunk &chunk : chunks) munmap(chunk.base, chunk.size);
+#endif
+}
+
+bool Jit::available() {
+    return JIT_SUPPORTED != 0;
+}
+
+BlockFn Jit::compile(const CPU &cpu, const vector<Instruction> &program, int start) {
+#if JIT_SUPPORTED
+    int programSize = static_cast<int>(program.size());
+
+    // find the end of the block and which guest registers it touches
+    vector<bool> used(12, false), written(12, false);
+    int end = start;
+    while (end < programSize && jitSupports(program[end])) {
+        const Instruction &ins = program[end];
+        if (ins.Rd >= 0) used[ins.Rd] = true;
+        if (ins.Rn >= 0) used[ins.Rn] = true;
+        if (!ins.op2.isImmediate && ins.op2.reg >= 0) used[ins.op2.reg] = true;
+        if (ins.Rd >= 0 && writesRd(ins.op)) written[ins.Rd] = true;
+        end++;
+        if (ins.op == OpType::BEQ && ins.branchTarget >= 0) break;
+    }
+    if (end == start) return nullptr;
+
+    BlockCompiler bc(layoutOf(cpu), used, written);
+    bc.prologue();
+    bool fallsThrough = true;
+    for (int i = start; i < end && fallsThrough; i++) {
+        fallsThrough = bc.instruction(program[i], i);
+    }
+    if (fallsThrough) bc.exitTo(end);
+
+    return reinterpret_cast<BlockFn>(place(bc.e.code));
+#else
+    (void)cpu;
+    (void)program;
+    (void)start;
+    return nullptr;
+#endif
+}
+
+// Pack a block into the first chunk with room, mapping a new chunk if none has.
+// Chunks are only writable while a block is copied in (never writable and
+// executable at the same time).
+void *Jit::place(const vector<uint8_t> &code) {
+#if JIT_SUPPORTED
+    // blocks start 16-byte aligned
+    size_t length = (code.size() + 15) & ~static_cast<size_t>(15);
+    CodeChunk *target = nullptr;
+    for (CodeChunk &chunk : chunks) {
+        if (chunk.size - chunk.used >= length) {
+            target = &chunk;
+            break;
+        }
+    }
+    if (target == nullptr) {
+        size_t size = CHUNK_SIZE;
+        while (size < length) size *= 2;
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+        chunks.push_back({static_cast<uint8_t *>(memory), size, 0});
+        target = &chunks.back();
+    }
+
+    if (mprotect(target->base, target->size, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    uint8_t *block = target->base + target->used;
+    memcpy(block, code.data(), code.size());
+    if (mprotect(target->base, target->size, PROT_READ | PROT_EXEC) != 0) return nullptr;
+    target->used += length;
+    return block;
+#else
+    (void)code;
+    return nullptr;
+#endif
+}
+
+// Run a program, falling back to the interpreter for untranslatable instructions
+void Jit::run(CPU &cpu, const vector<Instruction> &program) {
+    int programCounter = 0;
+    int programSize = static_cast<int>(program.size());
+    blocks.assign(program.size(), nullptr);
+    tried.assign(program.size(), false);
+    // the blocks of an earlier run are gone, so their memory can be reused
+    for (CodeChunk &chunk : chunks) chunk.used = 0;
+
+    while (programCounter < programSize) {
+        if (!tried[programCounter]) {
+            blocks[programCounter] = compile(cpu, program, programCounter);
+            tried[programCounter] = true;
+        }
+        if (blocks[programCounter]) {
+            programCounter = blocks[programCounter](&cpu);
+        } else {
+            programCounter = cpu.step(program, programCounter);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "cpu.h"
+#include "instr.h"
+using namespace std;
+
+// A translated basic block: runs on the CPU and returns the next instruction index
+typedef int (*BlockFn)(CPU *cpu);
+
+// Translates basic blocks of instructions into x86-64 machine code.
+// Anything the translator does not support is run by CPU::step instead.
+class Jit {
+public:
+    Jit();
+    ~Jit();
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // true if generated code can run on this host
+    static bool available();
+
+    // run a program, using native code for every block that can be translated
+    void run(CPU &cpu, const vector<Instruction> &program);
+
+private:
+    // translate the block starting at index start, nullptr if not possible
+    BlockFn compile(const CPU &cpu, const vector<Instruction> &program, int start);
+
+    // copy machine code into executable memory, nullptr if out of memory
+    void *place(const vector<uint8_t> &code);
+
+    // a piece of executable memory that blocks are packed into
+    struct CodeChunk {
+        uint8_t *base;
+        size_t size;
+        size_t used;
+    };
+
+    vector<BlockFn> blocks;     // compiled block for each start index
+    vector<bool> tried;         // already tried to compile at this index
+    vector<CodeChunk> chunks;   // reused by every run, unmapped by the destructor
+};
+
+#endif
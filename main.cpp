@@ -4,44 +4,146 @@
 #include "cpu.h"
 #include "parser.h"
 #include "helpers.h"
+#include "jit.h"
+#include "image.h"
+#include "watch.h"
 
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <exception>
 using namespace std;
 
+// Set up CPU memory: map the image if there is one, then load the data directives
+static bool setupMemory(CPU &cpu, GuestImage &image, const string &imageFileName,
+                        bool persist, const vector<uint32_t> &dataWords) {
+    if (!imageFileName.empty()) {
+        // only the program's stores may change the file, not the loader
+        if (persist && !dataWords.empty()) {
+            cerr << "Error: data directives cannot be used with --persist" << endl;
+            return false;
+        }
+        string error;
+        if (!image.map(imageFileName, persist, error)) {
+            cerr << "Error: " << error << endl;
+            return false;
+        }
+        cpu.attachMemory(image.words(), image.wordCount());
+    }
+    if (!cpu.loadData(dataWords)) {
+        cerr << "Error: data directives do not fit in image: " << imageFileName << endl;
+        return false;
+    }
+    return true;
+}
+
+// Check that the JIT and the interpreter end in the same state
+static bool sameState(const CPU &a, const CPU &b) {
+    for (int i = 0; i < 12; i++) {
+        if (a.regs[i] != b.regs[i]) return false;
+    }
+    if (a.memWords != b.memWords) return false;
+    for (uint32_t i = 0; i < a.memWords; i++) {
+        if (a.mem[i] != b.mem[i]) return false;
+    }
+    return a.nzcv.N == b.nzcv.N && a.nzcv.Z == b.nzcv.Z &&
+           a.nzcv.C == b.nzcv.C && a.nzcv.V == b.nzcv.V;
+}
+
 int main(int argc, char **argv) {
     //the input file 
-    string inputFileName;
-    if (argc > 1) {
-        inputFileName = argv[1]; //could be any file name but for this project were gonns stick wiht pp3 input
-    } else {
-        inputFileName = "PP3_input.txt"; //default
+    string inputFileName = "PP3_input.txt"; //default
+    bool useJit = false;     // --jit: run translated code, print only the final state
+    bool verifyJit = false;  // --verify-jit: compare the JIT against the interpreter
+    string imageFileName;    // --image FILE: map FILE as memory at MEM_BASE
+    bool persist = false;    // --persist: stores to the image are written back to FILE
+    bool watch = false;      // --watch: re-run every time the input file changes
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--jit") {
+            useJit = true;
+        } else if (arg == "--verify-jit") {
+            verifyJit = true;
+        } else if (arg == "--image") {
+            if (i + 1 >= argc) {
+                cerr << "Error: --image needs a file name" << endl;
+                return 1;
+            }
+            imageFileName = argv[++i];
+        } else if (arg == "--persist") {
+            persist = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else {
+            inputFileName = arg; //could be any file name but for this project were gonns stick wiht pp3 input
+        }
     }
 
-    ifstream inputFile(inputFileName);
-    if (!inputFile) {
-        cerr << "Error: Unable to open file: " << inputFileName << endl;
-        return 1;
+    if (watch) {
+        Watcher watcher(inputFileName, imageFileName);
+        return watcher.run();
     }
 
     // readng the non-empty lines
     vector<string> programLines;
-    string line;
-    while (getline(inputFile, line)) {
-        string trimmedLine = trim(line);
-        if (!trimmedLine.empty()) {
-            programLines.push_back(trimmedLine);
-        }
+    if (!readProgramLines(inputFileName, programLines)) {
+        cerr << "Error: Unable to open file: " << inputFileName << endl;
+        return 1;
     }
 
     // Parse program into instructions
-    vector<Instruction> programInstructions = parseProgram(programLines);
+    vector<Instruction> programInstructions;
+    vector<uint32_t> dataWords;
+    try {
+        programInstructions = parseProgram(programLines, dataWords);
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    if (verifyJit) {
+        // never write the image back here, each CPU gets its own private copy
+        CPU interpreted;
+        GuestImage interpretedImage;
+        if (!setupMemory(interpreted, interpretedImage, imageFileName, false, dataWords)) return 1;
+        interpreted.trace = false;
+        interpreted.run(programInstructions);
+
+        CPU translated;
+        GuestImage translatedImage;
+        if (!setupMemory(translated, translatedImage, imageFileName, false, dataWords)) return 1;
+        translated.trace = false;
+        Jit jit;
+        jit.run(translated, programInstructions);
+
+        Instruction finalState;
+        if (!sameState(interpreted, translated)) {
+            cerr << "JIT mismatch for " << inputFileName << endl;
+            finalState.raw = "Interpreter:";
+            interpreted.printState(finalState);
+            finalState.raw = "JIT:";
+            translated.printState(finalState);
+            return 1;
+        }
+        cout << "JIT matches interpreter for " << inputFileName << "\n";
+        return 0;
+    }
 
     //cmake CPU and run program
     CPU myCpu;
-    myCpu.run(programInstructions);
+    GuestImage image;
+    if (!setupMemory(myCpu, image, imageFileName, persist, dataWords)) return 1;
+    if (useJit) {
+        myCpu.trace = false;
+        Jit jit;
+        jit.run(myCpu, programInstructions);
+        Instruction finalState;
+        finalState.raw = "Final state:";
+        myCpu.printState(finalState);
+    } else {
+        myCpu.run(programInstructions);
+    }
 
     return 0;
 }
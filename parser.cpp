@@ -4,6 +4,9 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
 #include <cctype>
 using namespace std;
 //remove leading and trailing whitespace
@@ -64,113 +67,254 @@ Op2 parseOperand2(const string &operandStr) {
     return operand;
 }
 
-//main function to parse program lines into instructions
-vector<Instruction> parseProgram(const vector<string> &programLines) {
-    vector<Instruction> parsedInstructions;
-
-    // First pass: parse each line
-    for (const string &originalLine : programLines) {
-        string line = trimString(originalLine);
-        if (line.empty()) continue;
+//split a comma separated operand list
+vector<string> splitOperands(const string &operandsString) {
+    vector<string> operands;
+    string currentOperand;
+    for (char c : operandsString) {
+        if (c == ',') {
+            operands.push_back(trimString(currentOperand));
+            currentOperand.clear();
+        } else {
+            currentOperand.push_back(c);
+        }
+    }
+    if (!currentOperand.empty()) {
+        operands.push_back(trimString(currentOperand));
+    }
+    return operands;
+}
 
-        Instruction instruction;
-        instruction.raw = line;
+//read a whole file for .incbin, padded with zeros to a full word
+void appendBinaryFile(const string &path, vector<uint32_t> &dataWords) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        throw runtime_error(".incbin: unable to open file: " + path);
+    }
+    vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    while (bytes.size() % 4 != 0) {
+        bytes.push_back(0);
+    }
+    // words are little endian like the rest of the simulator
+    for (size_t i = 0; i < bytes.size(); i += 4) {
+        dataWords.push_back(static_cast<uint32_t>(bytes[i]) |
+                            (static_cast<uint32_t>(bytes[i + 1]) << 8) |
+                            (static_cast<uint32_t>(bytes[i + 2]) << 16) |
+                            (static_cast<uint32_t>(bytes[i + 3]) << 24));
+    }
+}
 
-        // Split first word (possible label or opcode) from rest
-        size_t firstSpaceIndex = line.find_first_of(" \t");
-        string firstWord = (firstSpaceIndex == string::npos) ? line : line.substr(0, firstSpaceIndex);
-        string restOfLine = (firstSpaceIndex == string::npos) ? "" : trimString(line.substr(firstSpaceIndex + 1));
+//parse one .word value, it has to fit in 32 bits (negative values are two's complement)
+uint32_t parseWordValue(const string &value) {
+    string str = value;
+    if (!str.empty() && str[0] == '#') str = str.substr(1);
+    size_t used = 0;
+    long long number = 0;
+    try {
+        if (!str.empty() && str[0] == '-') {
+            number = stoll(str, &used, 0);
+            if (number < -2147483648LL) used = 0;
+        } else {
+            unsigned long long positive = stoull(str, &used, 0);
+            if (positive > 0xFFFFFFFFull) used = 0;
+            number = static_cast<long long>(positive);
+        }
+    } catch (const logic_error &) {
+        used = 0;
+    }
+    if (used == 0 || used != str.size()) {
+        throw runtime_error(".word: bad value: " + value);
+    }
+    return static_cast<uint32_t>(number);
+}
 
-        string opcodeCandidate;
-        string operandsString;
+//check if a word names a data directive
+bool isDirectiveName(const string &word) {
+    return word == ".word" || word == ".space" || word == ".incbin";
+}
 
-        //check if first word is a label or opcode
-        string baseOpcode, condition;
-        bool setsFlags = false;
-        decodeOpcode(firstWord, baseOpcode, condition, setsFlags);
+//check if a line is a data directive (.word, .space, .incbin), also when a label is in front
+bool isDataDirective(const string &line) {
+    istringstream words(line);
+    string first, second;
+    words >> first >> second;
+    return isDirectiveName(first) || isDirectiveName(second);
+}
 
-        if (opFromBase(baseOpcode) == OpType::INVALID) {
-            //treat first word as label
-            instruction.label = firstWord;
-            instruction.hasLabel = true;
+//emit the data of a directive line into dataWords
+void parseDataDirective(const string &line, vector<uint32_t> &dataWords) {
+    size_t nameEnd = line.find_first_of(" \t");
+    string directive = line.substr(0, nameEnd);
+    // data has no instruction index, so a branch could never reach its label
+    if (!isDirectiveName(directive)) {
+        throw runtime_error("labels are not allowed on data directives: " + line);
+    }
+    string operandsString = (nameEnd == string::npos) ? "" : trimString(line.substr(nameEnd + 1));
 
-            if (!restOfLine.empty()) {
-                size_t spaceAfterOpcode = restOfLine.find_first_of(" \t");
-                opcodeCandidate = (spaceAfterOpcode == string::npos) ? restOfLine : restOfLine.substr(0, spaceAfterOpcode);
-                operandsString = (spaceAfterOpcode == string::npos) ? "" : trimString(restOfLine.substr(spaceAfterOpcode + 1));
-            }
-        } else {
-            opcodeCandidate = firstWord;
-            operandsString = restOfLine;
+    if (directive == ".word") {
+        if (operandsString.empty()) {
+            throw runtime_error(".word: no values");
+        }
+        for (const string &value : splitOperands(operandsString)) {
+            dataWords.push_back(parseWordValue(value));
+        }
+    } else if (directive == ".space") {
+        // size is in bytes, rounded up to whole words
+        string size = operandsString;
+        if (!size.empty() && size[0] == '#') size = size.substr(1);
+        if (size.empty() || size[0] == '-') {
+            throw runtime_error(".space: bad size: " + operandsString);
+        }
+        uint64_t bytes = stoull(size, nullptr, 0);
+        if (bytes > MEM_MAX_BYTES - dataWords.size() * 4) {
+            throw runtime_error(".space: data does not fit in memory: " + operandsString);
         }
+        dataWords.insert(dataWords.end(), static_cast<size_t>((bytes + 3) / 4), 0);
+    } else if (directive == ".incbin") {
+        string path = operandsString;
+        if (path.size() >= 2 && path.front() == '"' && path.back() == '"') {
+            path = path.substr(1, path.size() - 2);
+        }
+        appendBinaryFile(path, dataWords);
+    }
+    if (dataWords.size() * 4 > MEM_MAX_BYTES) {
+        throw runtime_error(directive + ": data does not fit in memory");
+    }
+}
 
-        //decode opcode
-        if (!opcodeCandidate.empty()) {
-            decodeOpcode(opcodeCandidate, baseOpcode, condition, setsFlags);
-            instruction.op = opFromBase(baseOpcode);
-            instruction.cond = condition;
-            instruction.setsFlags = setsFlags;
-        } else {
-            instruction.op = OpType::INVALID;
+//parse one trimmed, non-empty line into an instruction (branch targets are not linked)
+Instruction parseInstruction(const string &line) {
+    Instruction instruction;
+    instruction.raw = line;
+
+    // Split first word (possible label or opcode) from rest
+    size_t firstSpaceIndex = line.find_first_of(" \t");
+    string firstWord = (firstSpaceIndex == string::npos) ? line : line.substr(0, firstSpaceIndex);
+    string restOfLine = (firstSpaceIndex == string::npos) ? "" : trimString(line.substr(firstSpaceIndex + 1));
+
+    string opcodeCandidate;
+    string operandsString;
+
+    //check if first word is a label or opcode
+    string baseOpcode, condition;
+    bool setsFlags = false;
+    decodeOpcode(firstWord, baseOpcode, condition, setsFlags);
+
+    if (opFromBase(baseOpcode) == OpType::INVALID) {
+        //treat first word as label
+        instruction.label = firstWord;
+        instruction.hasLabel = true;
+
+        if (!restOfLine.empty()) {
+            size_t spaceAfterOpcode = restOfLine.find_first_of(" \t");
+            opcodeCandidate = (spaceAfterOpcode == string::npos) ? restOfLine : restOfLine.substr(0, spaceAfterOpcode);
+            operandsString = (spaceAfterOpcode == string::npos) ? "" : trimString(restOfLine.substr(spaceAfterOpcode + 1));
         }
+    } else {
+        opcodeCandidate = firstWord;
+        operandsString = restOfLine;
+    }
+
+    //decode opcode
+    if (!opcodeCandidate.empty()) {
+        decodeOpcode(opcodeCandidate, baseOpcode, condition, setsFlags);
+        instruction.op = opFromBase(baseOpcode);
+        instruction.cond = condition;
+        instruction.setsFlags = setsFlags;
+    } else {
+        instruction.op = OpType::INVALID;
+    }
+
+    instruction.args = operandsString;
+
+    // split operands by comma
+    vector<string> operands = splitOperands(operandsString);
+
+    //assign registers and operand2 based on opcode
+    if (instruction.op == OpType::MOV || instruction.op == OpType::MVN) {
+        if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
+        if (operands.size() >= 2) instruction.op2 = parseOperand2(operands[1]);
+    } 
+    else if (instruction.op == OpType::ADD || instruction.op == OpType::SUB || 
+             instruction.op == OpType::AND || instruction.op == OpType::ORR || 
+             instruction.op == OpType::EOR || instruction.op == OpType::LSL || 
+             instruction.op == OpType::LSR) {
+        if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
+        if (operands.size() >= 2) instruction.Rn = parseRegister(operands[1]);
+        if (operands.size() >= 3) instruction.op2 = parseOperand2(operands[2]);
+    } 
+    else if (instruction.op == OpType::CMP) {
+        instruction.setsFlags = true;
+        if (operands.size() >= 1) instruction.Rn = parseRegister(operands[0]);
+        if (operands.size() >= 2) instruction.op2 = parseOperand2(operands[1]);
+    } 
+    else if (instruction.op == OpType::LDR || instruction.op == OpType::STR) {
+        if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
+        if (operands.size() >= 2) instruction.Rn = parseRegister(operands[1]);
+    } 
+    else if (instruction.op == OpType::BEQ) {
+        if (operands.size() >= 1) instruction.targetLabel = operands[0];
+    }
+
+    return instruction;
+}
 
-        instruction.args = operandsString;
-
-        // split operands by comma
-        vector<string> operands;
-        string currentOperand;
-        for (char c : operandsString) {
-            if (c == ',') {
-                operands.push_back(trimString(currentOperand));
-                currentOperand.clear();
-            } else {
-                currentOperand.push_back(c);
-            }
+//resolve the branch target of the instruction at index by its label
+void linkBranch(vector<Instruction> &program, size_t index) {
+    Instruction &ins = program[index];
+    if (ins.op != OpType::BEQ || ins.targetLabel.empty()) return;
+    ins.branchTarget = -1;
+    for (size_t j = 0; j < program.size(); ++j) {
+        if (program[j].hasLabel && program[j].label == ins.targetLabel) {
+            ins.branchTarget = static_cast<int>(j);
+            break;
         }
-        if (!currentOperand.empty()) {
-            operands.push_back(trimString(currentOperand));
+    }
+}
+
+//read the non-empty lines of a stream, trimmed
+void readProgramLines(istream &input, vector<string> &lines) {
+    lines.clear();
+    string line;
+    while (getline(input, line)) {
+        string trimmedLine = trim(line);
+        if (!trimmedLine.empty()) {
+            lines.push_back(trimmedLine);
         }
+    }
+}
+
+//read the non-empty lines of a file, trimmed
+bool readProgramLines(const string &fileName, vector<string> &lines) {
+    ifstream inputFile(fileName);
+    if (!inputFile) {
+        return false;
+    }
+    readProgramLines(inputFile, lines);
+    return true;
+}
 
-        //assign registers and operand2 based on opcode
-        if (instruction.op == OpType::MOV || instruction.op == OpType::MVN) {
-            if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
-            if (operands.size() >= 2) instruction.op2 = parseOperand2(operands[1]);
-        } 
-        else if (instruction.op == OpType::ADD || instruction.op == OpType::SUB || 
-                 instruction.op == OpType::AND || instruction.op == OpType::ORR || 
-                 instruction.op == OpType::EOR || instruction.op == OpType::LSL || 
-                 instruction.op == OpType::LSR) {
-            if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
-            if (operands.size() >= 2) instruction.Rn = parseRegister(operands[1]);
-            if (operands.size() >= 3) instruction.op2 = parseOperand2(operands[2]);
-        } 
-        else if (instruction.op == OpType::CMP) {
-            instruction.setsFlags = true;
-            if (operands.size() >= 1) instruction.Rn = parseRegister(operands[0]);
-            if (operands.size() >= 2) instruction.op2 = parseOperand2(operands[1]);
-        } 
-        else if (instruction.op == OpType::LDR || instruction.op == OpType::STR) {
-            if (operands.size() >= 1) instruction.Rd = parseRegister(operands[0]);
-            if (operands.size() >= 2) instruction.Rn = parseRegister(operands[1]);
-        } 
-        else if (instruction.op == OpType::BEQ) {
-            if (operands.size() >= 1) instruction.label = operands[0];
+//main function to parse program lines into instructions, data directives are laid out from MEM_BASE in dataWords
+vector<Instruction> parseProgram(const vector<string> &programLines, vector<uint32_t> &dataWords) {
+    vector<Instruction> parsedInstructions;
+
+    // First pass: parse each line
+    for (const string &originalLine : programLines) {
+        string line = trimString(originalLine);
+        if (line.empty()) continue;
+
+        // data goes into memory, not into the instruction list
+        if (isDataDirective(line)) {
+            parseDataDirective(line, dataWords);
+            continue;
         }
 
-        parsedInstructions.push_back(instruction);
+        parsedInstructions.push_back(parseInstruction(line));
     }
 
     //fix BEQ branch targets by label positions
     for (size_t i = 0; i < parsedInstructions.size(); ++i) {
-        Instruction &ins = parsedInstructions[i];
-        if (ins.op == OpType::BEQ && !ins.label.empty()) {
-            for (size_t j = 0; j < parsedInstructions.size(); ++j) {
-                if (parsedInstructions[j].hasLabel && parsedInstructions[j].label == ins.label) {
-                    ins.branchTarget = static_cast<int>(j);
-                    break;
-                }
-            }
-        }
+        linkBranch(parsedInstructions, i);
     }
 
     return parsedInstructions;
@@ -4,10 +4,27 @@
 #include "instr.h"
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <istream>
 
 using namespace std;
 
-// Parse a list of program lines into instructions
-vector<Instruction> parseProgram(const vector<string> &lines);
+// Parse a list of program lines into instructions. Data directives (.word, .space,
+// .incbin) are emitted into dataWords, which is meant to be loaded at MEM_BASE.
+// Throws runtime_error on bad directives.
+vector<Instruction> parseProgram(const vector<string> &lines, vector<uint32_t> &dataWords);
+
+// Read the trimmed, non-empty lines of a source file or stream
+bool readProgramLines(const string &fileName, vector<string> &lines);
+void readProgramLines(istream &input, vector<string> &lines);
+
+// Check if a line is a data directive rather than an instruction
+bool isDataDirective(const string &line);
+
+// Parse one trimmed line into an instruction, without linking its branch target
+Instruction parseInstruction(const string &line);
+
+// Resolve the branch target of program[index] from the labels in program
+void linkBranch(vector<Instruction> &program, size_t index);
 
 #endif
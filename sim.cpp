@@ -0,0 +1,109 @@
+#include "sim.h"
+#include "parser.h"
+#include <sstream>
+#include <exception>
+using namespace std;
+
+Simulator::Simulator() : pc(0) {
+    state.trace = false;
+}
+
+// Parse a program from a string
+bool Simulator::loadProgram(const string &source, string &error) {
+    istringstream input(source);
+    vector<string> lines;
+    readProgramLines(input, lines);
+
+    vector<uint32_t> newData;
+    vector<Instruction> newProgram;
+    try {
+        newProgram = parseProgram(lines, newData);
+    } catch (const exception &e) {
+        error = e.what();
+        return false;
+    }
+    program.swap(newProgram);
+    dataWords.swap(newData);
+    reset();
+    return true;
+}
+
+// Start over with the loaded program
+void Simulator::reset() {
+    state.reset();
+    state.loadData(dataWords);
+    pc = 0;
+}
+
+bool Simulator::setRegister(int index, uint32_t value) {
+    if (index < 0 || index >= 12) return false;
+    state.regs[index] = value;
+    return true;
+}
+
+uint32_t Simulator::getRegister(int index) const {
+    if (index < 0 || index >= 12) return 0;
+    return state.regs[index];
+}
+
+bool Simulator::writeMemory(uint32_t address, uint32_t value) {
+    int index = -1;
+    if (!state.inMemRange(address, index)) return false;
+    state.mem[index] = value;
+    return true;
+}
+
+bool Simulator::readMemory(uint32_t address, uint32_t &value) const {
+    int index = -1;
+    if (!state.inMemRange(address, index)) return false;
+    value = state.mem[index];
+    return true;
+}
+
+// Grow memory, keeping what is already there
+void Simulator::setMemoryWords(uint32_t words) {
+    if (words <= state.memWords) return;
+    vector<uint32_t> contents(state.mem, state.mem + state.memWords);
+    contents.resize(words, 0);
+    state.loadData(contents);
+}
+
+void Simulator::setFlags(const Flags &flags) {
+    state.nzcv = flags;
+}
+
+Flags Simulator::getFlags() const {
+    return state.nzcv;
+}
+
+void Simulator::setObserver(StepObserver observer) {
+    state.observer = observer;
+}
+
+// Run to the end of the program
+uint64_t Simulator::run() {
+    return run(UINT64_MAX);
+}
+
+// Run with a step budget
+uint64_t Simulator::run(uint64_t budget) {
+    uint64_t taken = 0;
+    int programSize = static_cast<int>(program.size());
+    while (pc < programSize && taken < budget) {
+        pc = state.step(program, pc);
+        taken++;
+    }
+    return taken;
+}
+
+bool Simulator::finished() const {
+    return pc >= static_cast<int>(program.size());
+}
+
+int Simulator::programCounter() const {
+    return pc;
+}
+
+const CPU &Simulator::cpu() const {
+    return state;
+}
@@ -0,0 +1,64 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Embeddable simulator API (libsim.a). Nothing here writes to stdout and
+// every Simulator is independent, so many can run in one process.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "cpu.h"
+#include "instr.h"
+using namespace std;
+
+class Simulator {
+public:
+    Simulator();
+
+    // parse source text (same syntax as the input files) and reset the CPU,
+    // returns false and fills in error if the source cannot be parsed
+    bool loadProgram(const string &source, string &error);
+
+    // registers, flags and memory back to their state right after loadProgram
+    void reset();
+
+    // registers R0-R11, returns false for a bad index
+    bool setRegister(int index, uint32_t value);
+    uint32_t getRegister(int index) const;
+
+    // word aligned addresses from MEM_BASE, returns false outside memory
+    bool writeMemory(uint32_t address, uint32_t value);
+    bool readMemory(uint32_t address, uint32_t &value) const;
+
+    // grow memory to at least this many words (never shrinks it)
+    void setMemoryWords(uint32_t words);
+
+    void setFlags(const Flags &flags);
+    Flags getFlags() const;
+
+    // called after every step, including label-only lines and instructions
+    // whose condition failed (see StepObserver), pass nullptr to remove it
+    void setObserver(StepObserver observer);
+
+    // run until the program ends, returns how many steps were taken
+    uint64_t run();
+
+    // run until the program ends or budget steps have been taken (a budget of
+    // 0 takes none), returns how many steps were taken; every line counts as
+    // a step, even if its condition failed
+    uint64_t run(uint64_t budget);
+
+    // true once the program counter has run past the last instruction
+    bool finished() const;
+    int programCounter() const;
+
+    const CPU &cpu() const;
+
+private:
+    vector<Instruction> program;
+    vector<uint32_t> dataWords; // memory contents from the data directives
+    CPU state;
+    int pc;
+};
+
+#endif
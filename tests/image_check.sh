@@ -0,0 +1,40 @@
+#!/bin/sh
+# Run tests/image.txt on a mapped image (it sums the four words at 0x100 and
+# stores the sum over the first one), with and without --persist.
+# Run from the top directory: sh tests/image_check.sh
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# first word of a file as an unsigned decimal
+firstWord() {
+    od -An -tu4 -N4 "$1" | tr -d ' '
+}
+
+fail() {
+    echo "image check failed: $1"
+    exit 1
+}
+
+./sim --verify-jit --image tests/image.bin tests/image.txt || exit 1
+
+# without --persist the stores go to a private copy and the file stays as it was
+cp tests/image.bin "$work/private.bin"
+./sim --image "$work/private.bin" tests/image.txt > /dev/null || fail "private run"
+cmp -s tests/image.bin "$work/private.bin" || fail "private run changed the file"
+./sim --jit --image "$work/private.bin" tests/image.txt > /dev/null || fail "private JIT run"
+cmp -s tests/image.bin "$work/private.bin" || fail "private JIT run changed the file"
+
+# with --persist the sum (1 + 2 + 3 + 4) is written back to the file
+cp tests/image.bin "$work/persist.bin"
+./sim --persist --image "$work/persist.bin" tests/image.txt > /dev/null || fail "persist run"
+[ "$(firstWord "$work/persist.bin")" = 10 ] || fail "persist run did not write back"
+cp tests/image.bin "$work/persist.bin"
+./sim --jit --persist --image "$work/persist.bin" tests/image.txt > /dev/null || fail "persist JIT run"
+[ "$(firstWord "$work/persist.bin")" = 10 ] || fail "persist JIT run did not write back"
+
+# --image with nothing after it is an error, not a file name
+if ./sim --image 2> "$work/err.txt"; then fail "--image without a file name"; fi
+grep -q "needs a file name" "$work/err.txt" || fail "--image without a file name"
+
+echo "image checks passed"
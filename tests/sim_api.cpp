@@ -0,0 +1,129 @@
+// sim_api.cpp
+// Checks the embeddable Simulator API, built against libsim.a by make check
+#include "sim.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+static int failures = 0;
+
+static void expect(bool ok, const string &what) {
+    if (!ok) {
+        cerr << "sim_api: " << what << endl;
+        failures++;
+    }
+}
+
+// .word data is loaded at MEM_BASE and can be read and stored by the program
+static void testWordData() {
+    Simulator sim;
+    string error;
+    expect(sim.loadProgram(".word 7, 0xffffffff\n"
+                           "MOV R6, #0x100\n"
+                           "LDR R0, [R6]\n"
+                           "ADD R0, R0, #1\n"
+                           "STR R0, [R6]\n", error),
+           "loadProgram with .word failed: " + error);
+    uint32_t value = 0;
+    expect(sim.readMemory(0x104, value) && value == 0xffffffff, ".word value not in memory");
+    sim.run();
+    expect(sim.getRegister(0) == 8, "LDR of .word data");
+    expect(sim.readMemory(0x100, value) && value == 8, "STR over .word data");
+}
+
+// registers set before run are seen by the program
+static void testSetRegister() {
+    Simulator sim;
+    string error;
+    sim.loadProgram("ADD R2, R0, R1\n", error);
+    expect(sim.setRegister(0, 40) && sim.setRegister(1, 2), "setRegister");
+    expect(!sim.setRegister(12, 1), "setRegister accepted R12");
+    sim.run();
+    expect(sim.getRegister(2) == 42, "register set before run not used");
+}
+
+// a budget stops the run part way, and the next run carries on from there
+static void testBudget() {
+    Simulator sim;
+    string error;
+    sim.loadProgram("MOV R0, #1\nMOV R1, #2\nMOV R2, #3\nMOV R3, #4\n", error);
+    expect(sim.run(0) == 0 && sim.programCounter() == 0, "run(0) took a step");
+    expect(sim.run(3) == 3, "run(3) did not take 3 steps");
+    expect(!sim.finished() && sim.programCounter() == 3, "finished after a partial run");
+    expect(sim.getRegister(2) == 3 && sim.getRegister(3) == 0, "state after a partial run");
+    expect(sim.run(10) == 1, "run past the end took extra steps");
+    expect(sim.finished() && sim.getRegister(3) == 4, "not finished after the last step");
+    expect(sim.run() == 0, "run after finishing took a step");
+}
+
+// the observer sees every line, and executed is false for a failed
+// condition and for a line that is only a label
+static void testObserver() {
+    Simulator sim;
+    string error;
+    sim.loadProgram("MOV R0, #1\n"
+                    "CMP R0, #2\n"
+                    "MOVEQ R1, #5\n"
+                    "HERE\n"
+                    "ADD R2, R2, #1\n", error);
+    vector<bool> executed;
+    sim.setObserver([&](const Instruction &, const CPU &, bool ran) {
+        executed.push_back(ran);
+    });
+    sim.run();
+    vector<bool> expected = {true, true, false, false, true};
+    expect(executed == expected, "observer executed flags");
+    expect(sim.getRegister(1) == 0, "MOVEQ ran with a failed condition");
+}
+
+// reset puts registers, flags and memory back to the loaded state
+static void testReset() {
+    Simulator sim;
+    string error;
+    sim.loadProgram(".word 9\n"
+                    "MOV R6, #0x100\n"
+                    "MOV R0, #3\n"
+                    "STR R0, [R6]\n"
+                    "CMP R0, R0\n", error);
+    sim.run();
+    uint32_t value = 0;
+    expect(sim.readMemory(0x100, value) && value == 3, "store before reset");
+    sim.reset();
+    expect(!sim.finished() && sim.programCounter() == 0, "reset did not rewind");
+    expect(sim.getRegister(0) == 0 && sim.getRegister(6) == 0, "reset kept registers");
+    expect(!sim.getFlags().Z, "reset kept flags");
+    expect(sim.readMemory(0x100, value) && value == 9, "reset did not reload .word data");
+    sim.run();
+    expect(sim.getRegister(0) == 3 && sim.getFlags().Z, "run after reset");
+}
+
+// a source that cannot be parsed is rejected and keeps the old program
+static void testRejected() {
+    Simulator sim;
+    string error;
+    sim.loadProgram("MOV R0, #1\n", error);
+    expect(!sim.loadProgram(".word abc\n", error), "bad .word accepted");
+    expect(error.find("abc") != string::npos, "error does not name the bad value: " + error);
+    error.clear();
+    expect(!sim.loadProgram("MOV R0, #2\n.space -4\n", error), "negative .space accepted");
+    expect(error.find(".space") != string::npos, "error does not name the directive: " + error);
+    sim.run();
+    expect(sim.getRegister(0) == 1, "rejected source replaced the program");
+}
+
+int main() {
+    testWordData();
+    testSetRegister();
+    testBudget();
+    testObserver();
+    testReset();
+    testRejected();
+    if (failures > 0) {
+        cerr << failures << " sim_api check(s) failed" << endl;
+        return 1;
+    }
+    cout << "sim_api checks passed\n";
+    return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Edit a looping program while ./sim --watch runs on it, and check that every
+# incremental re-run ends in the same state as a fresh run of the edited file.
+# Covers the shifted branch targets and re-linking of labels that changed.
+# Run from the top directory: sh tests/watch_edit.sh
+
+work=$(mktemp -d)
+trap 'kill $watcher 2>/dev/null; rm -rf "$work"' EXIT
+src="$work/loop.txt"
+
+cat > "$src" <<'PROGRAM'
+MOV R0, #0
+MOV R1, #300
+LOOP ADD R0, R0, #1
+ADD R2, R2, R0
+CMP R0, R1
+BEQ DONE
+CMP R0, R0
+BEQ LOOP
+MOV R9, #1
+DONE MOV R3, R2
+MOV R4, #1
+PROGRAM
+
+./sim --watch "$src" > "$work/out.txt" 2>&1 &
+watcher=$!
+runs=0
+
+# wait for the next re-run and compare its final state with a fresh run
+check() {
+    runs=$((runs + 1))
+    for i in $(seq 100); do
+        [ "$(grep -c '^== done' "$work/out.txt")" -ge "$runs" ] && break
+        sleep 0.05
+    done
+    grep '^== .*resuming' "$work/out.txt" | tail -1
+    ./sim "$src" | tail -5 > "$work/fresh.txt"
+    grep -B5 '^== done' "$work/out.txt" | tail -6 | head -5 > "$work/watched.txt"
+    if ! diff "$work/fresh.txt" "$work/watched.txt" > /dev/null; then
+        echo "FAIL: $1"
+        exit 1
+    fi
+    echo "ok: $1"
+}
+
+check "first run"
+
+# a new line before the loop moves both branch targets
+sleep 0.1
+sed -i '2a MOV R5, #9' "$src"
+check "insert before loop"
+
+# a line after the loop only needs the last checkpoint
+sleep 0.1
+echo 'ADD R6, R4, #2' >> "$src"
+check "append"
+
+# a second DONE earlier than the old one: BEQ DONE is outside the edit but
+# must be re-linked to it (R9 is only set if the branch lands on the new one)
+sleep 0.1
+sed -i 's/^MOV R9, #1$/DONE MOV R9, #1/' "$src"
+check "new first DONE label"
+
+# rename the loop label and its branch in one edit
+sleep 0.1
+sed -i 's/^LOOP ADD/AGAIN ADD/; s/^BEQ LOOP$/BEQ AGAIN/' "$src"
+check "rename LOOP"
+
+echo "all watch edits ok"
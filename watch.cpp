@@ -0,0 +1,287 @@
+#include "watch.h"
+#include "parser.h"
+#include <iostream>
+#include <set>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <exception>
+#include <sys/stat.h>
+using namespace std;
+
+// how often the source file is checked for changes
+const int POLL_MILLISECONDS = 50;
+
+Watcher::Watcher(const string &fileName, const string &imageFileName)
+    : fileName(fileName), imageFileName(imageFileName), checkpointInterval(CHECKPOINT_INTERVAL),
+      firstModified(0), steps(0), unfinished(false) {}
+
+// Watch the source file and re-run on every change
+int Watcher::run() {
+    if (stat(fileName.c_str(), &source) != 0) {
+        cerr << "Error: Unable to open file: " << fileName << endl;
+        return 1;
+    }
+    if (reload()) execute();
+
+    while (true) {
+        // an interrupted run carries on even if the new file has the same lines
+        if (!unfinished) {
+            this_thread::sleep_for(chrono::milliseconds(POLL_MILLISECONDS));
+            if (!sourceChanged()) continue;
+        }
+        stat(fileName.c_str(), &source);
+        if (reload() || unfinished) execute();
+    }
+}
+
+// Compare the file's modification time and size with the last poll
+bool Watcher::sourceChanged() const {
+    struct stat current;
+    if (stat(fileName.c_str(), &current) != 0) return false;
+    return current.st_mtim.tv_sec != source.st_mtim.tv_sec ||
+           current.st_mtim.tv_nsec != source.st_mtim.tv_nsec ||
+           current.st_size != source.st_size;
+}
+
+// Read the file again and update the program
+bool Watcher::reload() {
+    vector<string> newLines;
+    if (!readProgramLines(fileName, newLines)) {
+        cerr << "Error: Unable to open file: " << fileName << endl;
+        return false;
+    }
+    if (!checkpoints.empty() && newLines == lines) return false;
+
+    try {
+        if (checkpoints.empty() || !incrementalLoad(newLines)) {
+            fullLoad(newLines);
+        }
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+// Parse the whole file and reset the CPU
+void Watcher::fullLoad(const vector<string> &newLines) {
+    vector<uint32_t> dataWords;
+    vector<Instruction> newProgram = parseProgram(newLines, dataWords);
+
+    unique_ptr<CPU> newCpu(new CPU());
+    unique_ptr<GuestImage> newImage(new GuestImage());
+    if (!imageFileName.empty()) {
+        string error;
+        if (!newImage->map(imageFileName, false, error)) {
+            throw runtime_error(error);
+        }
+        newCpu->attachMemory(newImage->words(), newImage->wordCount());
+    }
+    if (!newCpu->loadData(dataWords)) {
+        throw runtime_error("data directives do not fit in image: " + imageFileName);
+    }
+
+    program.swap(newProgram);
+    cpu = move(newCpu);
+    image = move(newImage);
+    lines = newLines;
+    dataLine.assign(lines.size(), false);
+    for (size_t i = 0; i < lines.size(); i++) {
+        dataLine[i] = isDataDirective(lines[i]);
+    }
+
+    checkpoints.clear();
+    checkpointInterval = CHECKPOINT_INTERVAL;
+    stores.clear();
+    cpu->storeLog = &stores;
+    steps = 0;
+    firstModified = 0;
+    saveCheckpoint(0, -1, false);
+}
+
+// Re-parse only the lines between the unchanged prefix and suffix
+bool Watcher::incrementalLoad(const vector<string> &newLines) {
+    size_t oldCount = lines.size();
+    size_t newCount = newLines.size();
+    size_t prefix = 0;
+    while (prefix < oldCount && prefix < newCount && lines[prefix] == newLines[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix &&
+           lines[oldCount - 1 - suffix] == newLines[newCount - 1 - suffix]) {
+        suffix++;
+    }
+    size_t oldEndLine = oldCount - suffix;
+    size_t newEndLine = newCount - suffix;
+
+    // changed data means changed memory, so start over
+    for (size_t i = prefix; i < oldEndLine; i++) {
+        if (dataLine[i]) return false;
+    }
+    for (size_t i = prefix; i < newEndLine; i++) {
+        if (isDataDirective(newLines[i])) return false;
+    }
+
+    // parse before touching anything so a bad line leaves the old program alone
+    vector<Instruction> changed;
+    for (size_t i = prefix; i < newEndLine; i++) {
+        changed.push_back(parseInstruction(newLines[i]));
+    }
+
+    size_t first = 0;
+    for (size_t i = 0; i < prefix; i++) {
+        if (!dataLine[i]) first++;
+    }
+    size_t oldEnd = first + (oldEndLine - prefix);
+    size_t newEnd = first + changed.size();
+    int delta = static_cast<int>(newEnd) - static_cast<int>(oldEnd);
+
+    // labels defined in the old or new lines can move any branch that uses them
+    set<string> changedLabels;
+    for (size_t i = first; i < oldEnd; i++) {
+        if (program[i].hasLabel) changedLabels.insert(program[i].label);
+    }
+    for (const Instruction &ins : changed) {
+        if (ins.hasLabel) changedLabels.insert(ins.label);
+    }
+
+    program.erase(program.begin() + first, program.begin() + oldEnd);
+    program.insert(program.begin() + first, changed.begin(), changed.end());
+
+    // a branch before the change that now goes somewhere else also counts as changed
+    size_t modified = first;
+    for (size_t i = 0; i < program.size(); i++) {
+        Instruction &ins = program[i];
+        if (ins.op != OpType::BEQ) continue;
+        if ((i >= first && i < newEnd) || changedLabels.count(ins.targetLabel)) {
+            int oldTarget = ins.branchTarget;
+            linkBranch(program, i);
+            if (i < modified && ins.branchTarget != oldTarget) modified = i;
+        } else if (ins.branchTarget >= static_cast<int>(oldEnd)) {
+            ins.branchTarget += delta;
+        }
+    }
+
+    lines.erase(lines.begin() + prefix, lines.begin() + oldEndLine);
+    lines.insert(lines.begin() + prefix, newLines.begin() + prefix, newLines.begin() + newEndLine);
+    dataLine.erase(dataLine.begin() + prefix, dataLine.begin() + oldEndLine);
+    dataLine.insert(dataLine.begin() + prefix, newEndLine - prefix, false);
+    firstModified = static_cast<int>(modified);
+    return true;
+}
+
+// Run from the latest checkpoint that is still valid for the new program
+void Watcher::execute() {
+    auto start = chrono::steady_clock::now();
+
+    // a checkpoint is usable if its run never reached the changed code,
+    // and it is not sitting on a branch target that may have moved
+    size_t use = 0;
+    for (size_t i = checkpoints.size(); i-- > 0;) {
+        const Checkpoint &cp = checkpoints[i];
+        if (cp.highestPc < firstModified &&
+            (cp.programCounter < firstModified ||
+             (cp.programCounter == firstModified && !cp.branched))) {
+            use = i;
+            break;
+        }
+    }
+    restoreCheckpoint(use);
+
+    int programCounter = checkpoints[use].programCounter;
+    int highestPc = checkpoints[use].highestPc;
+    uint64_t resumedAt = steps;
+    cout << "== " << fileName << ": resuming at instruction " << programCounter
+         << " after " << resumedAt << " steps ==\n";
+
+    int programSize = static_cast<int>(program.size());
+    bool branched = false;
+    unfinished = false;
+    while (programCounter < programSize) {
+        if (programCounter > highestPc) highestPc = programCounter;
+        int previous = programCounter;
+        programCounter = cpu->step(program, programCounter);
+        branched = (programCounter != previous + 1);
+        steps++;
+        if (steps - checkpoints.back().steps >= checkpointInterval) {
+            saveCheckpoint(programCounter, highestPc, branched);
+        }
+        if (steps % POLL_STEPS == 0 && sourceChanged()) {
+            unfinished = true;
+            break;
+        }
+    }
+    // the last checkpoint is where the next run picks up
+    if (checkpoints.back().steps != steps) {
+        saveCheckpoint(programCounter, highestPc, branched);
+    }
+    firstModified = programSize;
+
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    if (unfinished) {
+        cout << "== stopped after " << steps << " steps: " << fileName << " changed ==" << endl;
+        return;
+    }
+    cout << "== done: " << (steps - resumedAt) << " of " << steps << " steps re-run in "
+         << elapsed.count() << " us ==" << endl;
+}
+
+// Save the CPU state
+void Watcher::saveCheckpoint(int programCounter, int highestPc, bool branched) {
+    Checkpoint cp;
+    cp.steps = steps;
+    cp.programCounter = programCounter;
+    cp.highestPc = highestPc;
+    cp.branched = branched;
+    for (int i = 0; i < 12; i++) {
+        cp.regs[i] = cpu->regs[i];
+    }
+    cp.nzcv = cpu->nzcv;
+    // the stores since the previous checkpoint belong to it
+    if (!checkpoints.empty()) {
+        vector<pair<uint32_t, uint32_t>> &undo = checkpoints.back().undo;
+        undo.insert(undo.end(), stores.begin(), stores.end());
+    }
+    stores.clear();
+    checkpoints.push_back(move(cp));
+
+    // keep every other checkpoint; a dropped one's stores go to the one before it
+    if (checkpoints.size() > MAX_CHECKPOINTS) {
+        vector<Checkpoint> kept;
+        for (size_t i = 0; i < checkpoints.size(); i++) {
+            if (i % 2 == 0) {
+                kept.push_back(move(checkpoints[i]));
+            } else {
+                vector<pair<uint32_t, uint32_t>> &undo = kept.back().undo;
+                undo.insert(undo.end(), checkpoints[i].undo.begin(), checkpoints[i].undo.end());
+            }
+        }
+        checkpoints.swap(kept);
+        checkpointInterval *= 2;
+    }
+}
+
+// Put a saved state back into the CPU by undoing the stores made since then
+void Watcher::restoreCheckpoint(size_t index) {
+    for (size_t i = stores.size(); i-- > 0;) {
+        cpu->mem[stores[i].first] = stores[i].second;
+    }
+    stores.clear();
+    for (size_t c = checkpoints.size(); c-- > index;) {
+        const vector<pair<uint32_t, uint32_t>> &undo = checkpoints[c].undo;
+        for (size_t i = undo.size(); i-- > 0;) {
+            cpu->mem[undo[i].first] = undo[i].second;
+        }
+    }
+    checkpoints.resize(index + 1);
+    checkpoints[index].undo.clear();
+
+    const Checkpoint &cp = checkpoints[index];
+    steps = cp.steps;
+    for (int i = 0; i < 12; i++) {
+        cpu->regs[i] = cp.regs[i];
+    }
+    cpu->nzcv = cp.nzcv;
+}
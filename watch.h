@@ -0,0 +1,86 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include <sys/stat.h>
+#include "cpu.h"
+#include "image.h"
+#include "instr.h"
+using namespace std;
+
+// take a checkpoint every this many executed instructions (at first)
+const uint64_t CHECKPOINT_INTERVAL = 256;
+
+// past this many checkpoints every other one is dropped and the interval doubles
+const size_t MAX_CHECKPOINTS = 1024;
+
+// while running, check the source file for changes every this many steps
+const uint64_t POLL_STEPS = 4096;
+
+// CPU state saved during a run so a later run can resume from it
+struct Checkpoint {
+    uint64_t steps = 0;       // instructions executed before this point
+    int programCounter = 0;   // next instruction to execute
+    int highestPc = -1;       // highest instruction index executed so far
+    bool branched = false;    // programCounter was reached by a taken branch
+    uint32_t regs[12];
+    Flags nzcv;
+    // (word index, old value) for every store made after this checkpoint and
+    // before the next one, so memory is never copied as a whole
+    vector<pair<uint32_t, uint32_t>> undo;
+};
+
+// Runs a program and re-runs it every time its source file changes.
+// Only the changed lines are parsed again, and the run resumes from the
+// last checkpoint that never reached the first changed instruction.
+class Watcher {
+public:
+    // the image (if any) is always mapped privately, never written back
+    Watcher(const string &fileName, const string &imageFileName);
+
+    // watch forever, returns 1 if the file cannot be read
+    int run();
+
+private:
+    // read the file and bring the program up to date,
+    // returns false if nothing changed or the new source has errors
+    bool reload();
+
+    // parse everything and start over from instruction 0 (throws on errors)
+    void fullLoad(const vector<string> &newLines);
+
+    // replace only the changed lines, returns false if a full load is needed
+    bool incrementalLoad(const vector<string> &newLines);
+
+    // run from the latest usable checkpoint to the end of the program, or
+    // until the source file changes (so an endless loop can be edited away)
+    void execute();
+
+    // true if the file looks different from the last time we read it
+    bool sourceChanged() const;
+
+    void saveCheckpoint(int programCounter, int highestPc, bool branched);
+    // roll back to checkpoints[index] and drop the ones after it
+    void restoreCheckpoint(size_t index);
+
+    string fileName;
+    string imageFileName;
+    vector<string> lines;           // current source lines
+    vector<bool> dataLine;          // true for lines that are data directives
+    vector<Instruction> program;
+    unique_ptr<CPU> cpu;
+    unique_ptr<GuestImage> image;
+    vector<Checkpoint> checkpoints; // in the order they were taken
+    uint64_t checkpointInterval;    // steps between checkpoints, doubles as they thin out
+    vector<pair<uint32_t, uint32_t>> stores; // undo entries since the last checkpoint
+    int firstModified;              // first instruction that changed since the last run
+    uint64_t steps;                 // instructions executed in the current run
+    bool unfinished;                // the last run stopped early because the file changed
+    struct stat source;             // the file as of the last poll
+};
+
+#endif